@@ -0,0 +1,438 @@
+/**
+    gallery.cpp
+    Purpose: Match a query image against a gallery of reference images,
+    sharding the gallery across worker processes that share one
+    memory-mapped index file
+
+    Usage: ./gallery.out build [options ...] index img1 [img2 ...]
+           ./gallery.out query [options ...] index img
+*/
+
+#include <iostream>
+#include <cstdio>
+#include <sstream>
+#include <cstdlib>
+#include <cerrno>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/nonfree/features2d.hpp>
+#include "hypergraph.hpp"
+#include "match.hpp"
+#include "gallery.hpp"
+
+using namespace cv;
+using namespace std;
+
+struct Result {
+  int ref;
+  int score;
+  double distance;
+};
+
+// Weights of angle, ratio and descriptor similarity in hyperedge matching
+struct Coefficients {
+  double cang;
+  double crat;
+  double cdesc;
+};
+
+// Sent by every worker before its results
+struct ShardReport {
+  int n_results;
+  int n_refs;
+  long max_rss_kb;
+  long pss_kb;
+  double seconds;
+};
+
+bool resultCMP(const Result& r1, const Result& r2) {
+  if (r1.score != r2.score) {
+    return r1.score > r2.score;
+  }
+  return r1.distance < r2.distance;
+}
+
+gallery::Hypergraph buildHypergraph(Mat &img, size_t limit) {
+  gallery::Hypergraph h;
+  SurfFeatureDetector detector(400);
+  SurfDescriptorExtractor extractor;
+  detector.detect(img, h.kpts);
+  sort(h.kpts.begin(), h.kpts.end(), hypergraph::responseCMP);
+  h.kpts.resize(min(limit, h.kpts.size()));
+  extractor.compute(img, h.kpts, h.desc);
+
+  vector<Vec6f> triangleList;
+  h.edges = hypergraph::delaunay(img.size(), h.kpts, triangleList);
+  return h;
+}
+
+/**
+  Matches the query against one reference with the pair matcher
+
+  @return number of point matches and their mean distance
+*/
+Result matchReference(gallery::Hypergraph &query, gallery::Index &index, int ref,
+                      Coefficients &c) {
+  vector<KeyPoint> kpts = index.keypoints(ref);
+  Mat desc = index.descriptors(ref);
+  vector<vector<int> > edges = index.edges(ref);
+
+  vector<pair<int, int> > edge_matches = match::hyperedges(
+    query.edges, edges, query.kpts, kpts, query.desc, desc, c.cang, c.crat, c.cdesc, 0.40
+  );
+  vector<DMatch> matches = match::points(
+    edge_matches, query.desc, desc, query.edges, edges, 0.1
+  );
+
+  Result r;
+  r.ref = ref;
+  r.score = matches.size();
+  r.distance = 0;
+  for (size_t i = 0; i < matches.size(); i++) {
+    r.distance += matches[i].distance;
+  }
+  if (!matches.empty()) {
+    r.distance /= matches.size();
+  }
+  return r;
+}
+
+// Proportional set size of this process, the mapping counts once overall
+long pssKb() {
+  FILE *f = fopen("/proc/self/smaps_rollup", "r");
+  if (!f) {
+    return -1;
+  }
+  char line[256];
+  long pss = -1;
+  while (fgets(line, sizeof(line), f)) {
+    if (sscanf(line, "Pss: %ld kB", &pss) == 1) {
+      break;
+    }
+  }
+  fclose(f);
+  return pss;
+}
+
+bool writeAll(int fd, const void *data, size_t bytes) {
+  const char *p = (const char *) data;
+  while (bytes > 0) {
+    ssize_t n = write(fd, p, bytes);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    bytes -= n;
+  }
+  return true;
+}
+
+bool readAll(int fd, void *data, size_t bytes) {
+  char *p = (char *) data;
+  while (bytes > 0) {
+    ssize_t n = read(fd, p, bytes);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    bytes -= n;
+  }
+  return true;
+}
+
+/**
+  Worker side: maps the index, matches the query against the contiguous
+  block of references of this shard and sends its top results to fd
+*/
+void runShard(string index_path, gallery::Hypergraph &query, Coefficients &c,
+              int shard, int n_shards, int top, int fd) {
+  // The coordinator already checked the whole index, only this block is checked
+  gallery::Index index;
+  if (!index.open(index_path, false)) {
+    _exit(EXIT_FAILURE);
+  }
+  int begin = (long) index.size() * shard / n_shards;
+  int end = (long) index.size() * (shard + 1) / n_shards;
+  if (!index.validEntries(begin, end)) {
+    _exit(EXIT_FAILURE);
+  }
+
+  double t = (double) getTickCount();
+  vector<Result> results;
+  for (int ref = begin; ref < end; ref++) {
+    results.push_back(matchReference(query, index, ref, c));
+  }
+  int n = min((int) results.size(), top);
+  partial_sort(results.begin(), results.begin() + n, results.end(), resultCMP);
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  ShardReport report;
+  report.n_results = n;
+  report.n_refs = end - begin;
+  report.max_rss_kb = usage.ru_maxrss;
+  report.pss_kb = pssKb();
+  report.seconds = ((double) getTickCount() - t) / getTickFrequency();
+
+  bool ok = writeAll(fd, &report, sizeof(report)) &&
+            writeAll(fd, results.data(), sizeof(Result) * n);
+  _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/**
+  Coordinator side: forks one worker per shard, the query hypergraph reaches
+  them through the copy-on-write fork, then gathers and merges their top
+  results.
+
+  @return false if a worker failed
+*/
+bool queryGallery(string index_path, gallery::Hypergraph &query, Coefficients &c,
+                  int n_workers, int top, bool verbose, vector<Result> &results) {
+  // Nothing buffered may be flushed again by the workers
+  cout.flush();
+  fflush(stdout);
+  vector<int> fds(n_workers);
+  vector<pid_t> pids(n_workers);
+  for (int w = 0; w < n_workers; w++) {
+    int p[2];
+    if (pipe(p) < 0) {
+      perror("pipe");
+      exit(EXIT_FAILURE);
+    }
+    pids[w] = fork();
+    if (pids[w] < 0) {
+      perror("fork");
+      exit(EXIT_FAILURE);
+    }
+    if (pids[w] == 0) {
+      close(p[0]);
+      for (int k = 0; k < w; k++) {
+        close(fds[k]);
+      }
+      runShard(index_path, query, c, w, n_workers, top, p[1]);
+    }
+    close(p[1]);
+    fds[w] = p[0];
+  }
+
+  vector<Result> merged;
+  bool ok = true;
+  for (int w = 0; w < n_workers; w++) {
+    ShardReport report;
+    if (ok && readAll(fds[w], &report, sizeof(report))) {
+      vector<Result> shard_results(report.n_results);
+      ok = readAll(fds[w], shard_results.data(), sizeof(Result) * shard_results.size());
+      merged.insert(merged.end(), shard_results.begin(), shard_results.end());
+      if (verbose) {
+        cout << "  shard " << w << ": " << report.n_refs << " references in "
+             << report.seconds << " s, max RSS " << report.max_rss_kb
+             << " kB, PSS " << report.pss_kb << " kB" << endl;
+      }
+    } else {
+      ok = false;
+    }
+    close(fds[w]);
+  }
+  for (int w = 0; w < n_workers; w++) {
+    int status;
+    waitpid(pids[w], &status, 0);
+    ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+  }
+  if (!ok) {
+    return false;
+  }
+
+  int n = min((int) merged.size(), top);
+  partial_sort(merged.begin(), merged.begin() + n, merged.end(), resultCMP);
+  merged.resize(n);
+  results.swap(merged);
+  return true;
+}
+
+void usage(char* program_name) {
+  int n = 7;
+  string opts[] = {
+    "--limit", "--workers", "--top", "--scale", "--cang", "--crat", "--cdesc"
+  };
+  string description[] = {
+    "Keypoints kept per image, by response (default: 300)",
+    "Worker processes sharing the index (default: 1)",
+    "Results returned per query (default: 5)",
+    "Run the query with 1, 2, 4, ... workers and report the speedup",
+    "Constant of angle similarity (default: 1)",
+    "Constant of ratio similarity (default: 1)",
+    "Constant of SURF descriptor similarity (default: 1)"
+  };
+
+  cout << "Usage: " << program_name << " build [options ...] index img1 [img2 ...]" << endl;
+  cout << "       " << program_name << " query [options ...] index img" << endl;
+  cout << endl;
+  cout << "Options" << endl;
+  for (int i = 0; i < n; i++) {
+    cout << "  " << opts[i] << ": " << description[i] << endl;
+  }
+
+  exit(EXIT_FAILURE);
+}
+
+pair<bool, double> toDouble(string s) {
+  stringstream ss(s);
+  double x;
+  ss >> x;
+  if (!ss) {
+    return make_pair(false, 0);
+  }
+  return make_pair(true, x);
+}
+
+Mat readImage(char *path, char *program_name) {
+  Mat img = imread(path, CV_LOAD_IMAGE_GRAYSCALE);
+  if (!img.data) {
+    cout << "Error: " << path << " is not a valid image" << endl << endl;
+    usage(program_name);
+  }
+  return img;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    usage(argv[0]);
+  }
+  string mode = argv[1];
+  if (mode != "build" && mode != "query") {
+    usage(argv[0]);
+  }
+
+  int opt, opt_index = 0;
+  static struct option options[] = {
+    {"limit", required_argument, 0, 'l'},
+    {"workers", required_argument, 0, 'w'},
+    {"top", required_argument, 0, 't'},
+    {"scale", no_argument, 0, 's'},
+    {"cang", required_argument, 0, 'a'},
+    {"crat", required_argument, 0, 'r'},
+    {"cdesc", required_argument, 0, 'd'},
+    {0, 0, 0, 0}
+  };
+
+  int limit = 300, n_workers = 1, top = 5;
+  bool scale = false;
+  Coefficients c = {1, 1, 1};
+  pair<bool, double> convert_type(true, 0);
+  bool numbers = true;
+  optind = 2;
+  while ((opt = getopt_long(argc, argv, "l:w:t:sa:r:d:", options, &opt_index)) != -1) {
+    switch (opt) {
+      case 'l':
+        limit = atoi(optarg);
+        break;
+      case 'w':
+        n_workers = atoi(optarg);
+        break;
+      case 't':
+        top = atoi(optarg);
+        break;
+      case 's':
+        scale = true;
+        break;
+      case 'a':
+        convert_type = toDouble(optarg);
+        c.cang = convert_type.second;
+        numbers = numbers && convert_type.first;
+        break;
+      case 'r':
+        convert_type = toDouble(optarg);
+        c.crat = convert_type.second;
+        numbers = numbers && convert_type.first;
+        break;
+      case 'd':
+        convert_type = toDouble(optarg);
+        c.cdesc = convert_type.second;
+        numbers = numbers && convert_type.first;
+        break;
+      default:
+        usage(argv[0]);
+        break;
+    }
+  }
+  if (!numbers || limit <= 0 || n_workers <= 0 || top <= 0) {
+    usage(argv[0]);
+  }
+
+  if (mode == "build") {
+    if (argc - optind < 2) {
+      usage(argv[0]);
+    }
+    string index_path = argv[optind];
+    vector<string> names;
+    vector<gallery::Hypergraph> refs;
+    for (int i = optind + 1; i < argc; i++) {
+      Mat img = readImage(argv[i], argv[0]);
+      names.push_back(argv[i]);
+      refs.push_back(buildHypergraph(img, limit));
+      cout << argv[i] << ": " << refs.back().kpts.size() << " keypoints, "
+           << refs.back().edges.size() << " edges" << endl;
+    }
+    if (!gallery::writeIndex(index_path, names, refs)) {
+      cout << "Error: could not write " << index_path << endl;
+      return EXIT_FAILURE;
+    }
+    cout << endl << refs.size() << " references written to " << index_path << endl;
+    return 0;
+  }
+
+  if (argc - optind != 2) {
+    usage(argv[0]);
+  }
+  string index_path = argv[optind];
+  gallery::Index index;
+  if (!index.open(index_path)) {
+    cout << "Error: " << index_path << " is not a valid index" << endl;
+    return EXIT_FAILURE;
+  }
+  Mat img = readImage(argv[optind + 1], argv[0]);
+  gallery::Hypergraph query = buildHypergraph(img, limit);
+  cout << query.kpts.size() << " keypoints, " << query.edges.size()
+       << " edges in query, " << index.size() << " references" << endl;
+
+  vector<int> worker_counts;
+  for (int w = 1; scale && w < n_workers; w *= 2) {
+    worker_counts.push_back(w);
+  }
+  worker_counts.push_back(n_workers);
+
+  vector<Result> results;
+  double base_seconds = 0;
+  for (size_t i = 0; i < worker_counts.size(); i++) {
+    cout << endl << worker_counts[i] << " workers" << endl;
+    double t = (double) getTickCount();
+    if (!queryGallery(index_path, query, c, worker_counts[i], top, true, results)) {
+      cout << endl << "Error: a worker failed" << endl;
+      return EXIT_FAILURE;
+    }
+    double seconds = ((double) getTickCount() - t) / getTickFrequency();
+    if (i == 0) {
+      base_seconds = seconds;
+    }
+    cout << "  " << seconds << " s, " << index.size() / seconds
+         << " references/s, speedup " << base_seconds / seconds << endl;
+  }
+
+  cout << endl << "Top " << results.size() << " references" << endl;
+  for (size_t i = 0; i < results.size(); i++) {
+    cout << "  " << index.name(results[i].ref) << ": " << results[i].score
+         << " point matches, mean distance " << results[i].distance << endl;
+  }
+
+  return 0;
+}
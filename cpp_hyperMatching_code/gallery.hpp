@@ -0,0 +1,275 @@
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/nonfree/features2d.hpp>
+
+using namespace std;
+using namespace cv;
+
+/*
+  Read-only gallery of reference hypergraphs stored in a single file, meant to
+  be memory-mapped by several processes at once so the page cache holds one
+  copy of it no matter how many workers read it.
+
+  Layout (native endianness, sections 8 byte aligned):
+    IndexHeader
+    RefEntry[n_refs]
+    for every reference: keypoints as (x, y) float pairs,
+                         descriptors as n_kpts x desc_cols floats,
+                         hyperedges as int triples
+*/
+namespace gallery {
+    const char MAGIC[8] = {'H', 'G', 'I', 'D', 'X', '0', '1', '\0'};
+
+    struct IndexHeader {
+        char magic[8];
+        unsigned int n_refs;
+        unsigned int desc_cols;
+    };
+
+    struct RefEntry {
+        char name[240];
+        unsigned int n_kpts;
+        unsigned int n_edges;
+        unsigned long long kpts_offset;
+        unsigned long long desc_offset;
+        unsigned long long edges_offset;
+    };
+
+    struct Hypergraph {
+        vector<KeyPoint> kpts;
+        Mat desc;
+        vector<vector<int> > edges;
+    };
+
+    size_t align8(size_t n) {
+        return (n + 7) & ~((size_t) 7);
+    }
+
+    bool writePadded(FILE *f, const void *data, size_t bytes) {
+        static const char zeros[8] = {0};
+        if (bytes && fwrite(data, 1, bytes, f) != bytes) {
+            return false;
+        }
+        size_t pad = align8(bytes) - bytes;
+        return fwrite(zeros, 1, pad, f) == pad;
+    }
+
+    /*
+      Writes the reference hypergraphs to path, one name per reference.
+      Descriptors are stored as floats, all of them must have one row per
+      keypoint and the same number of columns. The index is written to a
+      temporary file renamed to path at the end, so path is never left half
+      written.
+
+      @return false on I/O error or inconsistent hypergraphs
+    */
+    bool writeIndex(string path, vector<string> &names, vector<Hypergraph> &refs) {
+        if (names.size() != refs.size()) {
+            return false;
+        }
+        IndexHeader header;
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.n_refs = refs.size();
+        header.desc_cols = 0;
+        for (size_t i = 0; i < refs.size() && !header.desc_cols; i++) {
+            header.desc_cols = refs[i].desc.cols;
+        }
+
+        vector<RefEntry> entries(refs.size());
+        size_t offset = align8(sizeof(IndexHeader)) +
+                        align8(sizeof(RefEntry) * refs.size());
+        for (size_t i = 0; i < refs.size(); i++) {
+            RefEntry &e = entries[i];
+            memset(e.name, 0, sizeof(e.name));
+            strncpy(e.name, names[i].c_str(), sizeof(e.name) - 1);
+            e.n_kpts = refs[i].kpts.size();
+            e.n_edges = refs[i].edges.size();
+            e.kpts_offset = offset;
+            offset += align8(sizeof(float) * 2 * e.n_kpts);
+            e.desc_offset = offset;
+            offset += align8(sizeof(float) * header.desc_cols * e.n_kpts);
+            e.edges_offset = offset;
+            offset += align8(sizeof(int) * 3 * e.n_edges);
+        }
+
+        string tmp_path = path + ".tmp";
+        FILE *f = fopen(tmp_path.c_str(), "wb");
+        if (!f) {
+            return false;
+        }
+        bool ok = writePadded(f, &header, sizeof(header)) &&
+                  writePadded(f, entries.data(), sizeof(RefEntry) * entries.size());
+        for (size_t i = 0; i < refs.size() && ok; i++) {
+            vector<float> pts;
+            for (size_t k = 0; k < refs[i].kpts.size(); k++) {
+                pts.push_back(refs[i].kpts[k].pt.x);
+                pts.push_back(refs[i].kpts[k].pt.y);
+            }
+            Mat desc;
+            refs[i].desc.convertTo(desc, CV_32F);
+            desc = desc.clone();
+            vector<int> edges;
+            for (size_t k = 0; k < refs[i].edges.size(); k++) {
+                edges.insert(edges.end(), refs[i].edges[k].begin(), refs[i].edges[k].end());
+            }
+            bool consistent = desc.rows == (int) refs[i].kpts.size() &&
+                              (desc.empty() || desc.cols == (int) header.desc_cols);
+            ok = consistent &&
+                 writePadded(f, pts.data(), sizeof(float) * pts.size()) &&
+                 writePadded(f, desc.data, sizeof(float) * desc.total()) &&
+                 writePadded(f, edges.data(), sizeof(int) * edges.size());
+        }
+        ok = fclose(f) == 0 && ok && rename(tmp_path.c_str(), path.c_str()) == 0;
+        if (!ok) {
+            remove(tmp_path.c_str());
+        }
+        return ok;
+    }
+
+    /*
+      Read-only view of an index file. Descriptors are returned as Mat
+      headers over the mapping, so they are never copied.
+    */
+    class Index {
+    public:
+        Index() : base(NULL), length(0) {}
+
+        ~Index() {
+            close();
+        }
+
+        /*
+          Maps the index at path and checks its header and reference table.
+          The sections of every reference are checked too unless
+          check_entries is false, then validEntries must be called on the
+          references that will be read.
+        */
+        bool open(string path, bool check_entries = true) {
+            close();
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st;
+            if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(IndexHeader)) {
+                ::close(fd);
+                return false;
+            }
+            length = st.st_size;
+            void *addr = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (addr == MAP_FAILED) {
+                length = 0;
+                return false;
+            }
+            base = (char *) addr;
+            if (memcmp(header().magic, MAGIC, sizeof(MAGIC)) != 0 ||
+                !fits(align8(sizeof(IndexHeader)), header().n_refs, sizeof(RefEntry)) ||
+                (check_entries && !validEntries(0, size()))) {
+                close();
+                return false;
+            }
+            return true;
+        }
+
+        void close() {
+            if (base) {
+                munmap(base, length);
+            }
+            base = NULL;
+            length = 0;
+        }
+
+        /*
+          Checks every count, offset and vertex id of the references in
+          [begin, end) against the mapping, so a truncated or stale index is
+          rejected instead of read out of bounds.
+        */
+        bool validEntries(int begin, int end) const {
+            const IndexHeader &h = header();
+            for (int i = begin; i < end; i++) {
+                const RefEntry &e = entry(i);
+                if (!memchr(e.name, '\0', sizeof(e.name)) ||
+                    !fits(e.kpts_offset, 2ULL * e.n_kpts, sizeof(float)) ||
+                    (h.desc_cols && e.n_kpts > length / h.desc_cols) ||
+                    !fits(e.desc_offset, (unsigned long long) e.n_kpts * h.desc_cols,
+                          sizeof(float)) ||
+                    !fits(e.edges_offset, 3ULL * e.n_edges, sizeof(int))) {
+                    return false;
+                }
+                const int *idx = (const int *) (base + e.edges_offset);
+                for (size_t k = 0; k < 3ULL * e.n_edges; k++) {
+                    if (idx[k] < 0 || idx[k] >= (int) e.n_kpts) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        int size() const {
+            return header().n_refs;
+        }
+
+        string name(int i) const {
+            return string(entry(i).name);
+        }
+
+        vector<KeyPoint> keypoints(int i) const {
+            const RefEntry &e = entry(i);
+            const float *pts = (const float *) (base + e.kpts_offset);
+            vector<KeyPoint> kpts(e.n_kpts);
+            for (size_t k = 0; k < e.n_kpts; k++) {
+                kpts[k].pt = Point2f(pts[2 * k], pts[2 * k + 1]);
+            }
+            return kpts;
+        }
+
+        Mat descriptors(int i) const {
+            const RefEntry &e = entry(i);
+            return Mat(e.n_kpts, header().desc_cols, CV_32F,
+                       (void *) (base + e.desc_offset));
+        }
+
+        vector<vector<int> > edges(int i) const {
+            const RefEntry &e = entry(i);
+            const int *idx = (const int *) (base + e.edges_offset);
+            vector<vector<int> > edges(e.n_edges, vector<int>(3));
+            for (size_t k = 0; k < e.n_edges; k++) {
+                for (int j = 0; j < 3; j++) {
+                    edges[k][j] = idx[3 * k + j];
+                }
+            }
+            return edges;
+        }
+
+    private:
+        char *base;
+        size_t length;
+
+        Index(const Index &);
+        Index &operator=(const Index &);
+
+        // Whether count elements of elem bytes at offset lie inside the mapping
+        bool fits(unsigned long long offset, unsigned long long count, size_t elem) const {
+            return offset % sizeof(float) == 0 && offset <= length &&
+                   count <= (length - offset) / elem;
+        }
+
+        const IndexHeader &header() const {
+            return *(const IndexHeader *) base;
+        }
+
+        const RefEntry &entry(int i) const {
+            return ((const RefEntry *) (base + align8(sizeof(IndexHeader))))[i];
+        }
+    };
+}
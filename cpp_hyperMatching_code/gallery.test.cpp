@@ -0,0 +1,111 @@
+#include <bits/stdc++.h>
+#include <unistd.h>
+#include "opencv2/core/core.hpp"
+#include "opencv2/nonfree/features2d.hpp"
+#include "gallery.hpp"
+#include "test.hpp"
+using namespace std;
+using namespace cv;
+
+gallery::Hypergraph syntheticRef(int n, uint64 seed) {
+    gallery::Hypergraph h;
+    synthetic(n, Size(640, 480), seed, h.kpts, h.desc, h.edges);
+    return h;
+}
+
+bool sameReference(gallery::Index &index, int i, gallery::Hypergraph &h) {
+    vector<KeyPoint> kpts = index.keypoints(i);
+    Mat desc = index.descriptors(i);
+    vector<vector<int> > edges = index.edges(i);
+
+    bool same = kpts.size() == h.kpts.size() && edges == h.edges &&
+                desc.rows == (int) h.kpts.size() && desc.type() == CV_32F &&
+                (desc.empty() || norm(desc, h.desc, NORM_INF) == 0);
+    for (size_t k = 0; k < kpts.size() && same; k++) {
+        same = kpts[k].pt == h.kpts[k].pt;
+    }
+    return same;
+}
+
+// Copies the first bytes of src to dst
+void truncatedCopy(string src, string dst, size_t bytes) {
+    ifstream in(src.c_str(), ios::binary);
+    vector<char> data(bytes);
+    in.read(data.data(), bytes);
+    ofstream out(dst.c_str(), ios::binary);
+    out.write(data.data(), in.gcount());
+}
+
+int main(int argc, char* argv[]) {
+    char path[] = "/tmp/gallery.test.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    string index_path = path;
+    string broken_path = index_path + ".broken";
+
+    vector<string> names;
+    vector<gallery::Hypergraph> refs;
+    names.push_back("first.png");
+    refs.push_back(syntheticRef(30, 1));
+    names.push_back("second.png");
+    refs.push_back(syntheticRef(17, 2));
+    names.push_back("empty.png");
+    refs.push_back(syntheticRef(0, 3));
+
+    check(gallery::writeIndex(index_path, names, refs), "index is written");
+
+    {
+        gallery::Index index;
+        check(index.open(index_path), "index is mapped");
+        check(index.size() == (int) refs.size(), "reference count is read back");
+        for (int i = 0; i < index.size() && i < (int) refs.size(); i++) {
+            check(index.name(i) == names[i], "name of " + names[i] + " is read back");
+            check(sameReference(index, i, refs[i]),
+                  "keypoints, descriptors and edges of " + names[i] + " are read back");
+        }
+    }
+
+    ifstream in(index_path.c_str(), ios::binary | ios::ate);
+    size_t length = in.tellg();
+    in.close();
+
+    gallery::Index index;
+    // More than the padding after the last section
+    truncatedCopy(index_path, broken_path, length - 16);
+    check(!index.open(broken_path), "truncated index is rejected");
+    truncatedCopy(index_path, broken_path, sizeof(gallery::IndexHeader) + 8);
+    check(!index.open(broken_path), "index without its reference table is rejected");
+
+    // A failed write leaves the previous index untouched
+    vector<string> short_names(names.begin(), names.end() - 1);
+    check(!gallery::writeIndex(index_path, short_names, refs),
+          "index with fewer names than references is not written");
+    vector<gallery::Hypergraph> bad_desc_refs = refs;
+    bad_desc_refs[1].desc = bad_desc_refs[1].desc.rowRange(0, 5);
+    check(!gallery::writeIndex(index_path, names, bad_desc_refs),
+          "index with inconsistent descriptors is not written");
+    check(index.open(index_path) && index.size() == (int) refs.size() &&
+          sameReference(index, 0, refs[0]) &&
+          access((index_path + ".tmp").c_str(), F_OK) != 0,
+          "failed writes keep the previous index and leave no temporary file");
+    index.close();
+
+    // Vertex id out of range
+    gallery::Hypergraph bad = syntheticRef(12, 4);
+    bad.edges[2][1] = 12;
+    vector<string> bad_names(1, "bad.png");
+    vector<gallery::Hypergraph> bad_refs(1, bad);
+    gallery::writeIndex(broken_path, bad_names, bad_refs);
+    check(!index.open(broken_path), "index with out of range vertex ids is rejected");
+    check(index.open(broken_path, false) && !index.validEntries(0, 1),
+          "out of range vertex ids are found when only the table is checked on open");
+
+    unlink(index_path.c_str());
+    unlink(broken_path.c_str());
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
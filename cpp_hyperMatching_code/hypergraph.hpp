@@ -0,0 +1,73 @@
+#include <vector>
+#include <map>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/nonfree/features2d.hpp>
+
+using namespace std;
+using namespace cv;
+
+namespace hypergraph {
+    // Orders keypoints by decreasing response
+    bool responseCMP(const KeyPoint& p1, const KeyPoint& p2) {
+      return p1.response > p2.response;
+    }
+
+    /**
+      Obtain a list of hyperedges from the Delaunay Triangulation computed with
+      some Image Keypoints
+
+      @param size Size of the image from which keypoints are extracted
+      @param kpts
+      @param triangleList Triangles found by the triangulation, in coordinates
+      @return hyperedges as triples of indices into kpts
+    */
+    vector<vector<int> > delaunay(Size size, vector<KeyPoint> &kpts,
+                                  vector<Vec6f> &triangleList) {
+      vector<Point2f> points;
+      KeyPoint::convert(kpts, points);
+      map<pair<double, double> , int> pt_idx;
+
+      // Mapping points with their indices
+      for (size_t i = 0; i < points.size(); i++) {
+        Point2f p = points[i];
+        pt_idx[make_pair(p.x, p.y)] = i;
+      }
+
+      // Triangulation
+      Rect rect(0, 0, size.width, size.height);
+      Subdiv2D subdiv(rect);
+      subdiv.insert(points);
+      subdiv.getTriangleList(triangleList);
+
+      // Converting to edges from coordinates to indices
+      int rect_count_outliers = 0;
+      int map_count_outliers = 0;
+      vector<Point2f> pt(3);
+      vector<vector<int> > edges;
+      for (size_t i = 0; i < triangleList.size(); i++) {
+        Vec6f t = triangleList[i];
+        pt[0] = Point2f(t[0], t[1]);
+        pt[1] = Point2f(t[2], t[3]);
+        pt[2] = Point2f(t[4], t[5]);
+        if (rect.contains(pt[0]) && rect.contains(pt[1]) && rect.contains(pt[2])) {
+          pair<double, double> p0 = make_pair(pt[0].x, pt[0].y);
+          pair<double, double> p1 = make_pair(pt[1].x, pt[1].y);
+          pair<double, double> p2 = make_pair(pt[2].x, pt[2].y);
+          if (pt_idx.count(p0) && pt_idx.count(p1) && pt_idx.count(p2)) {
+            vector<int> edge(3);
+            edge[0] = pt_idx[p0];
+            edge[1] = pt_idx[p1];
+            edge[2] = pt_idx[p2];
+            edges.push_back(edge);
+          } else {
+            map_count_outliers++;
+          }
+        } else {
+          rect_count_outliers++;
+        }
+      }
+
+      return edges;
+    }
+}
@@ -0,0 +1,222 @@
+/**
+    locality.bench.cpp
+    Purpose: Compare time and cache misses of hyperedge and point matching with the
+    keypoints in response order against Hilbert curve order
+
+    Usage: ./locality.out [img1 img2 [limit [repetitions]]]
+*/
+
+#include <bits/stdc++.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+#include "opencv2/nonfree/features2d.hpp"
+#include "hypergraph.hpp"
+#include "locality.hpp"
+#include "match.hpp"
+using namespace std;
+using namespace cv;
+
+// Hardware cache miss counter of this process, -1 if not available
+int openCacheMisses() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Keypoints, descriptors and hyperedges of both images in one order
+struct Hypergraphs {
+    vector<KeyPoint> kpts1, kpts2;
+    Mat desc1, desc2;
+    vector<vector<int> > edges1, edges2;
+};
+
+struct Run {
+    double edge_seconds, point_seconds;
+    long long edge_misses, point_misses;
+    size_t edge_matches, point_matches;
+};
+
+void startCounter(int fd) {
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+long long stopCounter(int fd) {
+    long long count = -1;
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+            count = -1;
+        }
+    }
+    return count;
+}
+
+// Edge matching and point matching, timed and counted separately
+Run runMatching(Hypergraphs &h) {
+    Run run;
+    int fd = openCacheMisses();
+
+    startCounter(fd);
+    double t = (double) getTickCount();
+    vector<pair<int, int> > edge_matches = match::hyperedges(
+        h.edges1, h.edges2, h.kpts1, h.kpts2, h.desc1, h.desc2, 1, 1, 1, 0.40
+    );
+    run.edge_seconds = ((double) getTickCount() - t) / getTickFrequency();
+    run.edge_misses = stopCounter(fd);
+
+    startCounter(fd);
+    t = (double) getTickCount();
+    vector<DMatch> matches = match::points(
+        edge_matches, h.desc1, h.desc2, h.edges1, h.edges2, 0.1
+    );
+    run.point_seconds = ((double) getTickCount() - t) / getTickFrequency();
+    run.point_misses = stopCounter(fd);
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    run.edge_matches = edge_matches.size();
+    run.point_matches = matches.size();
+    return run;
+}
+
+template<typename T>
+T median(vector<T> v) {
+    sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+// Median over the repetitions of every measure of the runs
+Run medianRun(vector<Run> &runs) {
+    vector<double> edge_seconds, point_seconds;
+    vector<long long> edge_misses, point_misses;
+    for (size_t i = 0; i < runs.size(); i++) {
+        edge_seconds.push_back(runs[i].edge_seconds);
+        point_seconds.push_back(runs[i].point_seconds);
+        edge_misses.push_back(runs[i].edge_misses);
+        point_misses.push_back(runs[i].point_misses);
+    }
+    Run run = runs[0];
+    run.edge_seconds = median(edge_seconds);
+    run.point_seconds = median(point_seconds);
+    run.edge_misses = median(edge_misses);
+    run.point_misses = median(point_misses);
+    return run;
+}
+
+void printStage(string stage, double seconds, long long misses) {
+    cout << "  " << stage << ": " << seconds << " s, ";
+    if (misses >= 0) {
+        cout << misses << " cache misses" << endl;
+    } else {
+        cout << "cache misses n/a" << endl;
+    }
+}
+
+void printRun(string name, Run &run) {
+    cout << name << " (" << run.edge_matches << " edge matches, "
+         << run.point_matches << " point matches)" << endl;
+    printStage("hyperedges", run.edge_seconds, run.edge_misses);
+    printStage("points    ", run.point_seconds, run.point_misses);
+}
+
+void printReduction(string stage, double base_seconds, double seconds,
+                    long long base_misses, long long misses) {
+    cout << "  " << stage << ": speedup " << base_seconds / seconds;
+    if (base_misses > 0 && misses >= 0) {
+        cout << ", cache miss reduction "
+             << 100 * (1.0 - (double) misses / base_misses) << " %";
+    }
+    cout << endl;
+}
+
+int main(int argc, char* argv[]) {
+    string path1 = "./house/house.seq0.png";
+    string path2 = "./house/house.seq80.png";
+    size_t limit = 300;
+    int repeats = 5;
+    if (argc >= 3) {
+        path1 = argv[1];
+        path2 = argv[2];
+    }
+    if (argc >= 4) {
+        limit = atoi(argv[3]);
+    }
+    if (argc >= 5) {
+        repeats = max(1, atoi(argv[4]));
+    }
+
+    Mat img1 = imread(path1, CV_LOAD_IMAGE_GRAYSCALE);
+    Mat img2 = imread(path2, CV_LOAD_IMAGE_GRAYSCALE);
+    if (!img1.data || !img2.data) {
+        cout << "Error: img1 and img2 must be valid images both" << endl;
+        return 1;
+    }
+
+    SurfFeatureDetector detector(400);
+    SurfDescriptorExtractor extractor;
+    Hypergraphs response;
+    detector.detect(img1, response.kpts1);
+    detector.detect(img2, response.kpts2);
+    sort(response.kpts1.begin(), response.kpts1.end(), hypergraph::responseCMP);
+    sort(response.kpts2.begin(), response.kpts2.end(), hypergraph::responseCMP);
+    response.kpts1.resize(min(limit, response.kpts1.size()));
+    response.kpts2.resize(min(limit, response.kpts2.size()));
+    extractor.compute(img1, response.kpts1, response.desc1);
+    extractor.compute(img2, response.kpts2, response.desc2);
+
+    vector<Vec6f> triangles1, triangles2;
+    response.edges1 = hypergraph::delaunay(img1.size(), response.kpts1, triangles1);
+    response.edges2 = hypergraph::delaunay(img2.size(), response.kpts2, triangles2);
+    cout << response.kpts1.size() << " x " << response.kpts2.size() << " keypoints, ";
+    cout << response.edges1.size() << " x " << response.edges2.size() << " edges, ";
+    cout << repeats << " repetitions" << endl << endl;
+
+    Hypergraphs hilbert = response;
+    hilbert.desc1 = response.desc1.clone();
+    hilbert.desc2 = response.desc2.clone();
+    locality::reorder(hilbert.kpts1, hilbert.desc1, hilbert.edges1, img1.size());
+    locality::reorder(hilbert.kpts2, hilbert.desc2, hilbert.edges2, img2.size());
+
+    // Warm-up, so allocator growth and lazy initialization aren't measured
+    runMatching(response);
+    runMatching(hilbert);
+
+    // Alternate which order runs first, so neither gets a systematic advantage
+    vector<Run> response_runs, hilbert_runs;
+    for (int i = 0; i < repeats; i++) {
+        if (i % 2 == 0) {
+            response_runs.push_back(runMatching(response));
+            hilbert_runs.push_back(runMatching(hilbert));
+        } else {
+            hilbert_runs.push_back(runMatching(hilbert));
+            response_runs.push_back(runMatching(response));
+        }
+    }
+    Run response_order = medianRun(response_runs);
+    Run hilbert_order = medianRun(hilbert_runs);
+
+    cout << "Median of " << repeats << " runs" << endl;
+    printRun("Response order", response_order);
+    printRun("Hilbert order", hilbert_order);
+    cout << "Hilbert vs response order" << endl;
+    printReduction("hyperedges", response_order.edge_seconds, hilbert_order.edge_seconds,
+                   response_order.edge_misses, hilbert_order.edge_misses);
+    printReduction("points    ", response_order.point_seconds, hilbert_order.point_seconds,
+                   response_order.point_misses, hilbert_order.point_misses);
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include <vector>
+#include <algorithm>
+#include <opencv2/core/core.hpp>
+#include <opencv2/nonfree/features2d.hpp>
+
+using namespace std;
+using namespace cv;
+
+/*
+  Reordering of keypoints, descriptor rows and hyperedges along a Hilbert
+  curve over the image, so triangles that are close in the image are close
+  in memory and so are the keypoints and descriptor rows they reference.
+*/
+namespace locality {
+    // Side of the grid the image is mapped to, must be a power of two
+    const unsigned HILBERT_SIDE = 1 << 16;
+
+    /*
+      Position of the cell (x, y) along the Hilbert curve filling a
+      side x side grid.
+    */
+    unsigned long long hilbertIndex(unsigned side, unsigned x, unsigned y) {
+        unsigned long long d = 0;
+        for (unsigned s = side / 2; s > 0; s /= 2) {
+            unsigned rx = (x & s) > 0;
+            unsigned ry = (y & s) > 0;
+            d += (unsigned long long) s * s * ((3 * rx) ^ ry);
+            // Rotate the quadrant
+            if (ry == 0) {
+                if (rx == 1) {
+                    x = s - 1 - x;
+                    y = s - 1 - y;
+                }
+                swap(x, y);
+            }
+        }
+        return d;
+    }
+
+    unsigned long long hilbertIndex(Point2f p, Size size) {
+        double sx = (double) (HILBERT_SIDE - 1) / max(size.width, 1);
+        double sy = (double) (HILBERT_SIDE - 1) / max(size.height, 1);
+        unsigned x = (unsigned) min(max(p.x * sx, 0.0), HILBERT_SIDE - 1.0);
+        unsigned y = (unsigned) min(max(p.y * sy, 0.0), HILBERT_SIDE - 1.0);
+        return hilbertIndex(HILBERT_SIDE, x, y);
+    }
+
+    /*
+      Sorts keypoints and descriptor rows along the Hilbert curve and renames
+      the vertices of the hyperedges accordingly, then sorts the hyperedges by
+      the Hilbert index of their centroid.
+
+      @return order, where order[i] is the original index of keypoint i
+    */
+    vector<int> reorder(vector<KeyPoint> &kpts, Mat &desc,
+                        vector<vector<int> > &edges, Size size) {
+        vector<pair<unsigned long long, int> > keys(kpts.size());
+        for (size_t i = 0; i < kpts.size(); i++) {
+            keys[i] = make_pair(hilbertIndex(kpts[i].pt, size), (int) i);
+        }
+        sort(keys.begin(), keys.end());
+
+        vector<int> order(kpts.size()), rank(kpts.size());
+        vector<KeyPoint> sorted_kpts(kpts.size());
+        Mat sorted_desc(desc.rows, desc.cols, desc.type());
+        for (size_t i = 0; i < keys.size(); i++) {
+            int old_idx = keys[i].second;
+            order[i] = old_idx;
+            rank[old_idx] = i;
+            sorted_kpts[i] = kpts[old_idx];
+            desc.row(old_idx).copyTo(sorted_desc.row(i));
+        }
+        kpts.swap(sorted_kpts);
+        desc = sorted_desc;
+
+        vector<pair<unsigned long long, int> > edge_keys(edges.size());
+        for (size_t i = 0; i < edges.size(); i++) {
+            Point2f centroid(0, 0);
+            for (int k = 0; k < 3; k++) {
+                edges[i][k] = rank[edges[i][k]];
+                centroid += kpts[edges[i][k]].pt;
+            }
+            edge_keys[i] = make_pair(hilbertIndex(centroid * (1.0 / 3), size), (int) i);
+        }
+        sort(edge_keys.begin(), edge_keys.end());
+
+        vector<vector<int> > sorted_edges(edges.size());
+        for (size_t i = 0; i < edge_keys.size(); i++) {
+            sorted_edges[i].swap(edges[edge_keys[i].second]);
+        }
+        edges.swap(sorted_edges);
+
+        return order;
+    }
+
+    /*
+      Undoes reorder on keypoints, descriptor rows and hyperedge vertices.
+      Hyperedges stay in Hilbert order, so hyperedge matches remain valid.
+    */
+    void restore(vector<KeyPoint> &kpts, Mat &desc,
+                 vector<vector<int> > &edges, vector<int> &order) {
+        vector<KeyPoint> orig_kpts(kpts.size());
+        Mat orig_desc(desc.rows, desc.cols, desc.type());
+        for (size_t i = 0; i < order.size(); i++) {
+            orig_kpts[order[i]] = kpts[i];
+            desc.row(i).copyTo(orig_desc.row(order[i]));
+        }
+        kpts.swap(orig_kpts);
+        desc = orig_desc;
+
+        for (size_t i = 0; i < edges.size(); i++) {
+            for (int k = 0; k < 3; k++) {
+                edges[i][k] = order[edges[i][k]];
+            }
+        }
+    }
+
+    // Makes point matches refer to the keypoints in their original order
+    void restoreMatches(vector<DMatch> &matches,
+                        vector<int> &order1, vector<int> &order2) {
+        for (size_t i = 0; i < matches.size(); i++) {
+            matches[i].queryIdx = order1[matches[i].queryIdx];
+            matches[i].trainIdx = order2[matches[i].trainIdx];
+        }
+    }
+}
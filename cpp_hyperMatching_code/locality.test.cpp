@@ -0,0 +1,108 @@
+#include <bits/stdc++.h>
+#include "opencv2/core/core.hpp"
+#include "opencv2/nonfree/features2d.hpp"
+#include "locality.hpp"
+#include "test.hpp"
+using namespace std;
+using namespace cv;
+
+bool samePoints(vector<KeyPoint> &a, vector<KeyPoint> &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].pt != b[i].pt || a[i].response != b[i].response) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sameMat(Mat &a, Mat &b) {
+    return a.size() == b.size() && a.type() == b.type() && norm(a, b, NORM_INF) == 0;
+}
+
+// Hyperedges as sorted coordinate triples, independent of any numbering
+multiset<vector<float> > edgeGeometry(vector<vector<int> > &edges,
+                                      vector<KeyPoint> &kpts) {
+    multiset<vector<float> > geometry;
+    for (size_t i = 0; i < edges.size(); i++) {
+        vector<pair<float, float> > pts;
+        for (int k = 0; k < 3; k++) {
+            pts.push_back(make_pair(kpts[edges[i][k]].pt.x, kpts[edges[i][k]].pt.y));
+        }
+        sort(pts.begin(), pts.end());
+        vector<float> g;
+        for (int k = 0; k < 3; k++) {
+            g.push_back(pts[k].first);
+            g.push_back(pts[k].second);
+        }
+        geometry.insert(g);
+    }
+    return geometry;
+}
+
+int main(int argc, char* argv[]) {
+    Size size(640, 480);
+    vector<KeyPoint> kpts1, kpts2;
+    Mat desc1, desc2;
+    vector<vector<int> > edges1, edges2;
+    synthetic(60, size, 1, kpts1, desc1, edges1);
+    synthetic(45, size, 2, kpts2, desc2, edges2);
+
+    vector<KeyPoint> orig_kpts1 = kpts1, orig_kpts2 = kpts2;
+    Mat orig_desc1 = desc1.clone(), orig_desc2 = desc2.clone();
+    vector<vector<int> > orig_edges1 = edges1;
+    multiset<vector<float> > geometry1 = edgeGeometry(edges1, kpts1);
+
+    vector<int> order1 = locality::reorder(kpts1, desc1, edges1, size);
+    vector<int> order2 = locality::reorder(kpts2, desc2, edges2, size);
+
+    bool permuted = order1.size() == orig_kpts1.size();
+    for (size_t i = 0; i < order1.size() && permuted; i++) {
+        permuted = kpts1[i].pt == orig_kpts1[order1[i]].pt &&
+                   norm(desc1.row(i), orig_desc1.row(order1[i]), NORM_INF) == 0;
+    }
+    check(permuted, "reorder moves keypoints and descriptor rows together");
+    check(edgeGeometry(edges1, kpts1) == geometry1,
+          "reorder keeps the hyperedges on the same points");
+
+    bool sorted = true;
+    for (size_t i = 1; i < kpts1.size(); i++) {
+        sorted = sorted && locality::hilbertIndex(kpts1[i - 1].pt, size) <=
+                           locality::hilbertIndex(kpts1[i].pt, size);
+    }
+    check(sorted, "reorder sorts keypoints along the Hilbert curve");
+
+    // Matches in reordered indices, restoreMatches must point to the same points
+    vector<KeyPoint> sorted_kpts1 = kpts1, sorted_kpts2 = kpts2;
+    vector<DMatch> matches;
+    for (size_t i = 0; i < kpts1.size(); i++) {
+        matches.push_back(DMatch(i, (i * 7) % kpts2.size(), 0));
+    }
+    vector<DMatch> sorted_matches = matches;
+
+    locality::restore(kpts1, desc1, edges1, order1);
+    locality::restore(kpts2, desc2, edges2, order2);
+    locality::restoreMatches(matches, order1, order2);
+
+    check(samePoints(kpts1, orig_kpts1) && samePoints(kpts2, orig_kpts2),
+          "restore gives back the original keypoints");
+    check(sameMat(desc1, orig_desc1) && sameMat(desc2, orig_desc2),
+          "restore gives back the original descriptor rows");
+
+    multiset<vector<int> > restored_edges(edges1.begin(), edges1.end());
+    multiset<vector<int> > original_edges(orig_edges1.begin(), orig_edges1.end());
+    check(restored_edges == original_edges,
+          "restore gives back the original vertex ids of the hyperedges");
+
+    bool remapped = true;
+    for (size_t i = 0; i < matches.size(); i++) {
+        remapped = remapped &&
+            orig_kpts1[matches[i].queryIdx].pt == sorted_kpts1[sorted_matches[i].queryIdx].pt &&
+            orig_kpts2[matches[i].trainIdx].pt == sorted_kpts2[sorted_matches[i].trainIdx].pt;
+    }
+    check(remapped, "restoreMatches maps match indices to the original keypoints");
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -15,7 +15,10 @@
 #include <getopt.h>
 #include <opencv2/core/core.hpp>
 #include <opencv2/nonfree/features2d.hpp>
+#include "hypergraph.hpp"
+#include "locality.hpp"
 #include "match.hpp"
+#include "verify.hpp"
 #include "draw.hpp"
 
 using namespace cv;
@@ -57,10 +60,6 @@ vector<vector<T> > getPermutation(vector<T> data) {
   return perms;
 }
 
-bool responseCMP(const KeyPoint& p1, const KeyPoint& p2) {
-    return p1.response > p2.response;
-}
-
 /*
 ######## ########   ######   ########  ######
 ##       ##     ## ##    ##  ##       ##    ##
@@ -73,7 +72,7 @@ bool responseCMP(const KeyPoint& p1, const KeyPoint& p2) {
 
 /**
   Obtain a list of hyperedges from the Delaunay Triangulation computed with
-  some Image Keypoints
+  some Image Keypoints, and show the triangulation
 
   @param img Image from which keypoints are extracted
   @param kpts
@@ -81,54 +80,11 @@ bool responseCMP(const KeyPoint& p1, const KeyPoint& p2) {
 */
 
 vector<vector<int> > delaunayTriangulation(Mat img, vector<KeyPoint> kpts) {
-  vector<Point2f> points;
-  KeyPoint::convert(kpts, points);
-  map<pair<double, double> , int> pt_idx;
-
-  // Mapping points with their indices
-  for (size_t i = 0; i < points.size(); i++) {
-    Point2f p = points[i];
-    pt_idx[make_pair(p.x, p.y)] = i;
-  }
-
-  // Triangulation
-  Size size = img.size();
-  Rect rect(0, 0, size.width, size.height);
-  Subdiv2D subdiv(rect);
-  subdiv.insert(points);
   vector<Vec6f> triangleList;
-  subdiv.getTriangleList(triangleList);
+  vector<vector<int> > edges = hypergraph::delaunay(img.size(), kpts, triangleList);
 
   draw::triangulation(img, triangleList);
 
-  // Converting to edges from coordinates to indices
-  int rect_count_outliers = 0;
-  int map_count_outliers = 0;
-  vector<Point2f> pt(3);
-  vector<vector<int> > edges;
-  for (size_t i = 0; i < triangleList.size(); i++) {
-    Vec6f t = triangleList[i];
-    pt[0] = Point2f(t[0], t[1]);
-    pt[1] = Point2f(t[2], t[3]);
-    pt[2] = Point2f(t[4], t[5]);
-    if (rect.contains(pt[0]) && rect.contains(pt[1]) && rect.contains(pt[2])) {
-      pair<double, double> p0 = make_pair(pt[0].x, pt[0].y);
-      pair<double, double> p1 = make_pair(pt[1].x, pt[1].y);
-      pair<double, double> p2 = make_pair(pt[2].x, pt[2].y);
-      if (pt_idx.count(p0) && pt_idx.count(p1) && pt_idx.count(p2)) {
-        vector<int> edge(3);
-        edge[0] = pt_idx[p0];
-        edge[1] = pt_idx[p1];
-        edge[2] = pt_idx[p2];
-        edges.push_back(edge);
-      } else {
-        map_count_outliers++;
-      }
-    } else {
-      rect_count_outliers++;
-    }
-  }
-
   return edges;
 }
 
@@ -142,7 +98,8 @@ vector<vector<int> > delaunayTriangulation(Mat img, vector<KeyPoint> kpts) {
 ##     ## ##     ## #### ##    ##
 */
 
-void doMatch(Mat &img1, Mat &img2, double cang, double crat, double cdesc) {
+void doMatch(Mat &img1, Mat &img2, double cang, double crat, double cdesc,
+             bool mutual, int topk, int verify_model, bool hilbert) {
   // Mat img1 = imread("./test-images/monster1s.JPG", 0);
   // Mat img2 = imread("./test-images/monster1m.JPG", 0);
 
@@ -158,8 +115,8 @@ void doMatch(Mat &img1, Mat &img2, double cang, double crat, double cdesc) {
   cout << endl << kpts1.size() << " Keypoints Detected in image 1" << endl;
   cout << endl << kpts2.size() << " Keypoints Detected in image 2" << endl;
 
-  sort(kpts1.begin(), kpts1.end(), responseCMP);
-  sort(kpts2.begin(), kpts2.end(), responseCMP);
+  sort(kpts1.begin(), kpts1.end(), hypergraph::responseCMP);
+  sort(kpts2.begin(), kpts2.end(), hypergraph::responseCMP);
 
   // Test vectors with less points
   int limit = 20;
@@ -190,25 +147,87 @@ void doMatch(Mat &img1, Mat &img2, double cang, double crat, double cdesc) {
   cout << endl << "Triangulation Done." << endl;
   cout << Edges1.size() << " Edges from image 1" << endl;
   cout << Edges2.size() << " Edges from image 2" << endl;
+
+  vector<int> order1, order2;
+  if (hilbert) {
+    order1 = locality::reorder(kpts1, descriptor1, Edges1, img1.size());
+    order2 = locality::reorder(kpts2, descriptor2, Edges2, img2.size());
+  }
+
   cout << endl << "Matching ..." << endl;
 
-  vector<pair<int, int> > edge_matches = match::hyperedges(
-    Edges1, Edges2,
-    kpts1, kpts2,
-    descriptor1, descriptor2,
-    cang, crat, cdesc, 0.40
-  );
+  vector<pair<int, int> > edge_matches;
+  match::Candidates candidates;
+  if (topk > 0) {
+    candidates = match::hyperedgesTopK(
+      Edges1, Edges2,
+      kpts1, kpts2,
+      descriptor1, descriptor2,
+      cang, crat, cdesc, 0.40, topk
+    );
+  } else if (mutual) {
+    edge_matches = match::mutualHyperedges(
+      Edges1, Edges2,
+      kpts1, kpts2,
+      descriptor1, descriptor2,
+      cang, crat, cdesc, 0.40
+    );
+  } else {
+    edge_matches = match::hyperedges(
+      Edges1, Edges2,
+      kpts1, kpts2,
+      descriptor1, descriptor2,
+      cang, crat, cdesc, 0.40
+    );
+  }
 
   cout << endl << "Edges Matching done. ";
-  cout << edge_matches.size() << " edge matches passed!" << endl;
+  if (topk > 0) {
+    cout << candidates.size() << " edge candidates passed!" << endl;
+  } else {
+    cout << edge_matches.size() << " edge matches passed!" << endl;
+  }
 
-  vector<DMatch> matches = match::points(
-    edge_matches, descriptor1, descriptor2,  Edges1, Edges2, 0.1
-  );
+  vector<DMatch> matches;
+  if (topk > 0) {
+    matches = match::points(
+      candidates, descriptor1, descriptor2,  Edges1, Edges2, 0.1
+    );
+  } else {
+    matches = match::points(
+      edge_matches, descriptor1, descriptor2,  Edges1, Edges2, 0.1
+    );
+  }
 
   cout << endl << "Point Matching Done. ";
   cout << matches.size() << " Point matches passed!" << endl;
 
+  if (hilbert) {
+    locality::restore(kpts1, descriptor1, Edges1, order1);
+    locality::restore(kpts2, descriptor2, Edges2, order2);
+    locality::restoreMatches(matches, order1, order2);
+  }
+
+  if (verify_model >= 0) {
+    Mat model;
+    if (topk > 0) {
+      // Hypotheses come from every candidate, the best scored first
+      edge_matches = match::candidatePairs(candidates);
+    }
+    matches = verify::geometric(
+      edge_matches, matches, kpts1, kpts2, Edges1, Edges2,
+      (verify::Model) verify_model, model
+    );
+
+    if (!model.empty()) {
+      cout << endl << "Geometric Verification Done. ";
+      cout << matches.size() << " Point matches are inliers!" << endl;
+      cout << "Model:" << endl << model << endl;
+    } else {
+      cout << endl << "Geometric Verification skipped, no model could be made." << endl;
+    }
+  }
+
   // Draw Edges matching
   // draw::edgesMatch(
   //   img1, img2, edge_matches, Edges1, Edges2, kpts1, kpts2
@@ -228,12 +247,18 @@ void cright() {
 }
 
 void usage(char* program_name) {
-  int n = 3;
-  string opts[] = {"--cang", "--crat", "--cdesc"};
+  int n = 7;
+  string opts[] = {
+    "--cang", "--crat", "--cdesc", "--mutual", "--topk", "--verify", "--hilbert"
+  };
   string description[] = {
     "Constant of angle similarity (default: 1)",
     "Constant of ratio similarity (default: 1)",
-    "Constant of SURF descriptor similarity (default: 1)"
+    "Constant of SURF descriptor similarity (default: 1)",
+    "Keep only mutually best hyperedge matches (default: off)",
+    "Keep the k best hyperedge matches of every edge (default: 0, only the best)",
+    "Keep only point matches consistent with a 'similarity' or 'affine' transform (default: off)",
+    "Reorder keypoints and edges along a Hilbert curve before matching (default: off)"
   };
 
   cout << "Usage: " << program_name << " [options ...] img1 img2" << endl;
@@ -262,12 +287,20 @@ int main(int argc, char *argv[]) {
     {"cang", required_argument, 0, 'a'},
     {"crat", required_argument, 0, 'r'},
     {"cdesc", required_argument, 0, 'd'},
+    {"mutual", no_argument, 0, 'm'},
+    {"topk", required_argument, 0, 'k'},
+    {"verify", required_argument, 0, 'v'},
+    {"hilbert", no_argument, 0, 'H'},
     {0, 0, 0, 0}
   };
 
   double cang = 1, crat = 1, cdesc = 1;
+  bool mutual = false;
+  int topk = 0;
+  int verify_model = -1;
+  bool hilbert = false;
   pair<bool, double> convert_type(true, 0);
-  while ((opt = getopt_long(argc, argv, "a:r:d:", options, &opt_index)) != -1) {
+  while ((opt = getopt_long(argc, argv, "a:r:d:mk:v:H", options, &opt_index)) != -1) {
     switch (opt) {
       case 'a':
         convert_type = toDouble(optarg);
@@ -281,6 +314,30 @@ int main(int argc, char *argv[]) {
         convert_type = toDouble(optarg);
         cdesc = convert_type.second;
         break;
+      case 'm':
+        mutual = true;
+        break;
+      case 'k':
+        convert_type = toDouble(optarg);
+        if (!convert_type.first || convert_type.second < 1 ||
+            convert_type.second != floor(convert_type.second)) {
+          cout << "Error: --topk must be a positive integer" << endl << endl;
+          usage(argv[0]);
+        }
+        topk = (int) convert_type.second;
+        break;
+      case 'v':
+        if (string(optarg) == "similarity") {
+          verify_model = verify::SIMILARITY;
+        } else if (string(optarg) == "affine") {
+          verify_model = verify::AFFINE;
+        } else {
+          usage(argv[0]);
+        }
+        break;
+      case 'H':
+        hilbert = true;
+        break;
       default:
         usage(argv[0]);
         break;
@@ -291,6 +348,11 @@ int main(int argc, char *argv[]) {
     usage(argv[0]);
   }
 
+  if (mutual && topk > 0) {
+    cout << "Error: --mutual and --topk can't be used together" << endl << endl;
+    usage(argv[0]);
+  }
+
   if (argc - optind != 2) {
     cout << "Error: You must provide two images" << endl << endl;
     usage(argv[0]);
@@ -305,7 +367,7 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  doMatch(img[0], img[1], cang, crat, cdesc);
+  doMatch(img[0], img[1], cang, crat, cdesc, mutual, topk, verify_model, hilbert);
 
   return 0;
 }
@@ -2,6 +2,8 @@
 #include <cmath>
 #include <algorithm>
 #include <set>
+#include <map>
+#include <functional>
 #include <opencv2/core/core.hpp>
 #include <opencv2/nonfree/features2d.hpp>
 #include "similarity.hpp"
@@ -10,6 +12,50 @@ using namespace std;
 using namespace cv;
 
 namespace match {
+    /*
+      Sparse top-k candidate matrix in CSR layout. Candidates of edge i of
+      image 1 are cols/scores[row_ptr[i] .. row_ptr[i + 1]), sorted by
+      decreasing score, so its size is bounded by k * edges1.size().
+    */
+    struct Candidates {
+        vector<int> row_ptr;
+        vector<int> cols;
+        vector<double> scores;
+
+        int rows() const { return (int) row_ptr.size() - 1; }
+        int size() const { return (int) cols.size(); }
+    };
+
+    // Coefficients of the edge similarity, normalized to sum 1
+    struct Weights {
+        double cang, crat, cdesc, sigma;
+
+        Weights(double cang, double crat, double cdesc, double sigma = 0.5) {
+            double _sum = cang + crat + cdesc;
+            this->cang = cang / _sum;
+            this->crat = crat / _sum;
+            this->cdesc = cdesc / _sum;
+            this->sigma = sigma;
+        }
+    };
+
+    double edgeSimilarity(vector<int> &edge1, vector<int> &edge2,
+                          vector<KeyPoint> &kp1, vector<KeyPoint> &kp2,
+                          Mat &desc1, Mat &desc2, const Weights &w) {
+        vector<Point2f> e1_points(3), e2_points(3);
+        vector<Mat> des_1(3), des_2(3);
+        for (int k = 0; k < 3; k++) {
+            e1_points[k] = kp1[edge1[k]].pt;
+            e2_points[k] = kp2[edge2[k]].pt;
+            des_1[k] = desc1.row(edge1[k]);
+            des_2[k] = desc2.row(edge2[k]);
+        }
+        double sim_angles = sim::angles(e1_points, e2_points, w.sigma);
+        double sim_ratios = sim::ratios(e1_points, e2_points, w.sigma);
+        double sim_desc = sim::descriptors(des_1, des_2, w.sigma);
+        return w.cang * sim_angles + w.crat * sim_ratios + w.cdesc * sim_desc;
+    }
+
     vector< pair<int, int> > hyperedges(vector<vector<int> > &edges1,
                                         vector<vector<int> > &edges2,
                                         vector<KeyPoint> &kp1,
@@ -17,31 +63,17 @@ namespace match {
                                         Mat &desc1, Mat &desc2,
                                         double cang, double crat, double cdesc,
                                         double thresholding) {
-        double sigma = 0.5;
+        Weights w(cang, crat, cdesc);
         vector< pair<int, int> > matches;
-        double _sum = cang + crat + cdesc;
-        cang /= _sum;
-        crat /= _sum;
-        cdesc /= _sum;
 
         for (size_t i = 0; i < edges1.size(); i++) {
             int best_match_idx = -1;
             double max_similarity = -1E30;
 
             for (size_t j = 0; j < edges2.size(); j++) {
-                vector<Point2f> e1_points(3), e2_points(3);
-                vector<Mat> des_1(3), des_2(3);
-                for (int k = 0; k < 3; k++) {
-                    e1_points[k] = kp1[edges1[i][k]].pt;
-                    e2_points[k] = kp2[edges2[j][k]].pt;
-                    des_1[k] = desc1.row(edges1[i][k]);
-                    des_2[k] = desc2.row(edges2[j][k]);
-                }
-                double sim_angles = sim::angles(e1_points, e2_points, sigma);
-                double sim_ratios = sim::ratios(e1_points, e2_points, sigma);
-                double sim_desc = sim::descriptors(des_1, des_2, sigma);
-                double similarity = cang * sim_angles + crat * sim_ratios +
-                                    cdesc * sim_desc;
+                double similarity = edgeSimilarity(
+                    edges1[i], edges2[j], kp1, kp2, desc1, desc2, w
+                );
 
                 if (similarity > max_similarity) {
                     best_match_idx = j;
@@ -55,6 +87,134 @@ namespace match {
         return matches;
     }
 
+    /*
+      Same scoring as hyperedges, but in the single pass over (i, j) we also
+      keep the best i for every j, so only pairs that are each other's best
+      match are returned. This is the cross-check of running hyperedges in
+      both directions without paying for the second pass.
+    */
+    vector< pair<int, int> > mutualHyperedges(vector<vector<int> > &edges1,
+                                              vector<vector<int> > &edges2,
+                                              vector<KeyPoint> &kp1,
+                                              vector<KeyPoint> &kp2,
+                                              Mat &desc1, Mat &desc2,
+                                              double cang, double crat, double cdesc,
+                                              double thresholding) {
+        Weights w(cang, crat, cdesc);
+        vector< pair<int, int> > matches;
+
+        vector<int> row_best_idx(edges1.size(), -1);
+        vector<double> row_best_sim(edges1.size(), -1E30);
+        vector<int> col_best_idx(edges2.size(), -1);
+        vector<double> col_best_sim(edges2.size(), -1E30);
+
+        for (size_t i = 0; i < edges1.size(); i++) {
+            for (size_t j = 0; j < edges2.size(); j++) {
+                double similarity = edgeSimilarity(
+                    edges1[i], edges2[j], kp1, kp2, desc1, desc2, w
+                );
+
+                if (similarity > row_best_sim[i]) {
+                    row_best_idx[i] = j;
+                    row_best_sim[i] = similarity;
+                }
+                if (similarity > col_best_sim[j]) {
+                    col_best_idx[j] = i;
+                    col_best_sim[j] = similarity;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < edges1.size(); i++) {
+            int j = row_best_idx[i];
+            if (j >= 0 && col_best_idx[j] == (int) i &&
+                row_best_sim[i] >= thresholding) {
+                matches.push_back(make_pair(i, j));
+            }
+        }
+        return matches;
+    }
+
+    /*
+      Whether candidate a = (score, j) ranks before b: higher score first and,
+      as in hyperedges, the lowest j on ties.
+    */
+    bool candidateBefore(const pair<double, int> &a, const pair<double, int> &b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    }
+
+    /*
+      Same scoring as hyperedges, but instead of the single best j for every
+      i it keeps the k best j scoring at least thresholding, k > 0. Every row
+      is sorted by rank, so its first entry is the j hyperedges would pick.
+    */
+    Candidates hyperedgesTopK(vector<vector<int> > &edges1,
+                              vector<vector<int> > &edges2,
+                              vector<KeyPoint> &kp1,
+                              vector<KeyPoint> &kp2,
+                              Mat &desc1, Mat &desc2,
+                              double cang, double crat, double cdesc,
+                              double thresholding, int k) {
+        CV_Assert(k > 0);
+        Weights w(cang, crat, cdesc);
+        Candidates candidates;
+
+        candidates.row_ptr.reserve(edges1.size() + 1);
+        candidates.row_ptr.push_back(0);
+        // Heap ordered by rank, its top is the worst of the k kept so far
+        vector<pair<double, int> > heap;
+        for (size_t i = 0; i < edges1.size(); i++) {
+            heap.clear();
+            for (size_t j = 0; j < edges2.size(); j++) {
+                double similarity = edgeSimilarity(
+                    edges1[i], edges2[j], kp1, kp2, desc1, desc2, w
+                );
+                if (similarity < thresholding) {
+                    continue;
+                }
+                pair<double, int> candidate(similarity, j);
+                if ((int) heap.size() < k) {
+                    heap.push_back(candidate);
+                    push_heap(heap.begin(), heap.end(), candidateBefore);
+                } else if (candidateBefore(candidate, heap.front())) {
+                    pop_heap(heap.begin(), heap.end(), candidateBefore);
+                    heap.back() = candidate;
+                    push_heap(heap.begin(), heap.end(), candidateBefore);
+                }
+            }
+            sort_heap(heap.begin(), heap.end(), candidateBefore);
+            for (size_t h = 0; h < heap.size(); h++) {
+                candidates.cols.push_back(heap[h].second);
+                candidates.scores.push_back(heap[h].first);
+            }
+            candidates.row_ptr.push_back(candidates.cols.size());
+        }
+        return candidates;
+    }
+
+    // Every (i, j) candidate pair, by decreasing score
+    vector<pair<int, int> > candidatePairs(Candidates &candidates) {
+        vector<pair<double, int> > order;
+        for (int c = 0; c < candidates.size(); c++) {
+            order.push_back(make_pair(-candidates.scores[c], c));
+        }
+        // Ties keep their CSR order
+        sort(order.begin(), order.end());
+
+        vector<int> row(candidates.size());
+        for (int i = 0; i < candidates.rows(); i++) {
+            for (int c = candidates.row_ptr[i]; c < candidates.row_ptr[i + 1]; c++) {
+                row[c] = i;
+            }
+        }
+        vector<pair<int, int> > pairs;
+        for (size_t o = 0; o < order.size(); o++) {
+            int c = order[o].second;
+            pairs.push_back(make_pair(row[c], candidates.cols[c]));
+        }
+        return pairs;
+    }
+
     double descDistance(Mat e1, Mat e2) {
         Mat diffs;
         absdiff(e1, e2, diffs);
@@ -62,6 +222,32 @@ namespace match {
         return dist;
     }
 
+    /*
+      For every vertex j of edge1, the vertex best_match[j] of edge2 with the
+      most similar descriptor and that similarity.
+    */
+    void vertexMatches(vector<int> &edge1, vector<int> &edge2,
+                       Mat &desc1, Mat &desc2, double sigma,
+                       vector<int> &best_match, vector<double> &best_sim) {
+        vector<Mat> des_1(3), des_2(3);
+        for (int k = 0; k < 3; k++) {
+            des_1[k] = desc1.row(edge1[k]);
+            des_2[k] = desc2.row(edge2[k]);
+        }
+
+        for (int j = 0; j < 3; j++) {
+            best_sim[j] = -1E30;
+            for (int k = 0; k < 3; k++) {
+                double _sim = exp(-sum(abs(des_1[j] - des_2[k]))[0] / sigma);
+
+                if (_sim > best_sim[j]) {
+                    best_sim[j] = _sim;
+                    best_match[j] = k;
+                }
+            }
+        }
+    }
+
     vector<DMatch> points(
         vector<pair<int, int> > edge_matches,
         Mat &desc1, Mat &desc2,
@@ -73,24 +259,10 @@ namespace match {
         for (size_t i = 0; i < edge_matches.size(); i++) {
             int base_edge_idx = edge_matches[i].first;
             int ref_edge_idx  = edge_matches[i].second;
-            vector<Mat> des_1(3), des_2(3);
-            for (int k = 0; k < 3; k++) {
-                des_1[k] = desc1.row(edges1[base_edge_idx][k]);
-                des_2[k] = desc2.row(edges2[ref_edge_idx][k]);
-            }
-
             vector<int> best_match(3);
-            vector<double> best_sim(3, -1E30);
-            for (int j = 0; j < 3; j++) {
-                for (int k = 0; k < 3; k++) {
-                    double _sim = exp(-sum(abs(des_1[j] - des_2[k]))[0] / sigma);
-
-                    if (_sim > best_sim[j]) {
-                        best_sim[j] = _sim;
-                        best_match[j] = k;
-                    }
-                }
-            }
+            vector<double> best_sim(3);
+            vertexMatches(edges1[base_edge_idx], edges2[ref_edge_idx],
+                          desc1, desc2, sigma, best_match, best_sim);
 
             for (int j = 0; j < 3; j++) {
                 int k = best_match[j];
@@ -107,4 +279,51 @@ namespace match {
         }
         return matches;
     }
+
+    /*
+      Point matching over the candidate rows. A point of image 1 can be
+      proposed by several candidates of several edges, only the proposal
+      with the highest edge score times descriptor similarity is kept, so
+      every point gets at most one match.
+    */
+    vector<DMatch> points(
+        Candidates &candidates,
+        Mat &desc1, Mat &desc2,
+        vector<vector<int> > &edges1, vector<vector<int> > &edges2,
+        double th, double sigma = 0.5
+    ) {
+        map<int, pair<double, DMatch> > best;
+        vector<int> best_match(3);
+        vector<double> best_sim(3);
+        for (int i = 0; i < candidates.rows(); i++) {
+            for (int c = candidates.row_ptr[i]; c < candidates.row_ptr[i + 1]; c++) {
+                int ref_edge_idx = candidates.cols[c];
+                vertexMatches(edges1[i], edges2[ref_edge_idx],
+                              desc1, desc2, sigma, best_match, best_sim);
+
+                for (int j = 0; j < 3; j++) {
+                    if (best_sim[j] <= th) {
+                        continue;
+                    }
+                    int qI = edges1[i][j];
+                    int tI = edges2[ref_edge_idx][best_match[j]];
+                    double weight = candidates.scores[c] * best_sim[j];
+
+                    map<int, pair<double, DMatch> >::iterator it = best.find(qI);
+                    if (it == best.end() || weight > it->second.first) {
+                        double _dist = -sigma * log(best_sim[j]);
+                        best[qI] = make_pair(weight, DMatch(qI, tI, _dist));
+                    }
+                }
+            }
+        }
+
+        vector<DMatch> matches;
+        matches.reserve(best.size());
+        map<int, pair<double, DMatch> >::iterator it;
+        for (it = best.begin(); it != best.end(); it++) {
+            matches.push_back(it->second.second);
+        }
+        return matches;
+    }
 }
@@ -0,0 +1,98 @@
+#include <bits/stdc++.h>
+#include "opencv2/core/core.hpp"
+#include "opencv2/nonfree/features2d.hpp"
+#include "match.hpp"
+#include "test.hpp"
+using namespace std;
+using namespace cv;
+
+const double TH = 0.3;
+
+// Two unrelated synthetic images, enough to exercise the matchers
+struct Images {
+    vector<KeyPoint> kpts1, kpts2;
+    Mat desc1, desc2;
+    vector<vector<int> > edges1, edges2;
+
+    Images() {
+        synthetic(25, Size(640, 480), 1, kpts1, desc1, edges1);
+        synthetic(25, Size(640, 480), 2, kpts2, desc2, edges2);
+    }
+};
+
+void testMutual(Images &im) {
+    vector<pair<int, int> > best = match::hyperedges(
+        im.edges1, im.edges2, im.kpts1, im.kpts2, im.desc1, im.desc2, 1, 1, 1, TH
+    );
+    vector<pair<int, int> > mutual = match::mutualHyperedges(
+        im.edges1, im.edges2, im.kpts1, im.kpts2, im.desc1, im.desc2, 1, 1, 1, TH
+    );
+
+    set<pair<int, int> > best_set(best.begin(), best.end());
+    bool subset = true;
+    set<int> cols;
+    bool unique_cols = true;
+    for (size_t i = 0; i < mutual.size(); i++) {
+        subset = subset && best_set.count(mutual[i]);
+        unique_cols = unique_cols && cols.insert(mutual[i].second).second;
+    }
+    check(!best.empty(), "hyperedges finds matches");
+    check(subset, "every mutual pair is a hyperedges pair");
+    check(unique_cols, "no edge of image 2 is in two mutual pairs");
+}
+
+void testTopK(Images &im, int k) {
+    vector<pair<int, int> > best = match::hyperedges(
+        im.edges1, im.edges2, im.kpts1, im.kpts2, im.desc1, im.desc2, 1, 1, 1, TH
+    );
+    match::Candidates candidates = match::hyperedgesTopK(
+        im.edges1, im.edges2, im.kpts1, im.kpts2, im.desc1, im.desc2, 1, 1, 1, TH, k
+    );
+    map<int, int> best_j(best.begin(), best.end());
+
+    bool bounded = candidates.rows() == (int) im.edges1.size();
+    bool sorted = true, first_is_best = true;
+    for (int i = 0; i < candidates.rows() && bounded; i++) {
+        int begin = candidates.row_ptr[i], end = candidates.row_ptr[i + 1];
+        bounded = end - begin <= k;
+        for (int c = begin + 1; c < end; c++) {
+            sorted = sorted && candidates.scores[c - 1] >= candidates.scores[c];
+        }
+        if (begin < end) {
+            first_is_best = first_is_best && best_j.count(i) &&
+                            best_j[i] == candidates.cols[begin];
+        } else {
+            first_is_best = first_is_best && !best_j.count(i);
+        }
+    }
+    string name = "top-" + to_string(k) + ": ";
+    check(bounded, name + "every row has at most k candidates");
+    check(sorted, name + "every row is sorted by decreasing score");
+    check(first_is_best, name + "the first candidate of every row is the hyperedges match");
+
+    if (k == 1) {
+        vector<pair<int, int> > pairs = match::candidatePairs(candidates);
+        set<pair<int, int> > top1(pairs.begin(), pairs.end());
+        check(top1 == set<pair<int, int> >(best.begin(), best.end()),
+              name + "same edge matches as hyperedges");
+    }
+
+    vector<DMatch> matches = match::points(
+        candidates, im.desc1, im.desc2, im.edges1, im.edges2, 0.1
+    );
+    set<int> queries;
+    bool one_per_point = true;
+    for (size_t m = 0; m < matches.size(); m++) {
+        one_per_point = one_per_point && queries.insert(matches[m].queryIdx).second;
+    }
+    check(one_per_point, name + "points gives at most one match per keypoint of image 1");
+}
+
+int main(int argc, char* argv[]) {
+    Images im;
+    testMutual(im);
+    testTopK(im, 1);
+    testTopK(im, 4);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,43 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/nonfree/features2d.hpp>
+#include "hypergraph.hpp"
+
+using namespace std;
+using namespace cv;
+
+/*
+  Minimal harness shared by the *.test.cpp programs: every check prints its
+  result, and main returns failures ? EXIT_FAILURE : EXIT_SUCCESS.
+*/
+int failures = 0;
+
+void check(bool ok, string what) {
+    cout << (ok ? "[ OK ] " : "[FAIL] ") << what << endl;
+    if (!ok) {
+        failures++;
+    }
+}
+
+/*
+  n random keypoints in an image of the given size, with decreasing
+  response, random 64 column descriptors and their Delaunay hyperedges.
+*/
+void synthetic(int n, Size size, uint64 seed, vector<KeyPoint> &kpts,
+               Mat &desc, vector<vector<int> > &edges) {
+    RNG rng(seed);
+    kpts.clear();
+    for (int i = 0; i < n; i++) {
+        Point2f p(rng.uniform(0.f, (float) size.width), rng.uniform(0.f, (float) size.height));
+        kpts.push_back(KeyPoint(p, 1, -1, n - i));
+    }
+    desc = Mat();
+    if (n > 0) {
+        desc.create(n, 64, CV_32F);
+        rng.fill(desc, RNG::UNIFORM, Scalar(-1), Scalar(1));
+    }
+    vector<Vec6f> triangleList;
+    edges = hypergraph::delaunay(size, kpts, triangleList);
+}
@@ -0,0 +1,170 @@
+#include <vector>
+#include <cmath>
+#include <map>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/nonfree/features2d.hpp>
+
+using namespace std;
+using namespace cv;
+
+/*
+  Geometric verification of point matches. Every hyperedge match whose three
+  vertices were also matched by match::points is already a minimal sample for
+  a similarity or an affine transform, so hypotheses are taken one by one from
+  the edge matches instead of sampling at random like RANSAC.
+*/
+namespace verify {
+    enum Model { SIMILARITY, AFFINE };
+
+    /*
+      Least squares rotation + uniform scale + translation taking p to q
+      (Umeyama without reflection), as a 2x3 matrix.
+    */
+    Mat similarityFromPoints(vector<Point2f> &p, vector<Point2f> &q) {
+        Point2d pc(0, 0), qc(0, 0);
+        for (size_t i = 0; i < p.size(); i++) {
+            pc += Point2d(p[i].x, p[i].y);
+            qc += Point2d(q[i].x, q[i].y);
+        }
+        pc *= 1.0 / p.size();
+        qc *= 1.0 / q.size();
+
+        double a = 0, b = 0, norm_p = 0;
+        for (size_t i = 0; i < p.size(); i++) {
+            Point2d dp = Point2d(p[i].x, p[i].y) - pc;
+            Point2d dq = Point2d(q[i].x, q[i].y) - qc;
+            a += dp.x * dq.x + dp.y * dq.y;
+            b += dp.x * dq.y - dp.y * dq.x;
+            norm_p += dp.x * dp.x + dp.y * dp.y;
+        }
+        if (norm_p < 1E-12) {
+            return Mat();
+        }
+
+        double c = a / norm_p;
+        double s = b / norm_p;
+        Mat M = (Mat_<double>(2, 3) <<
+            c, -s, qc.x - (c * pc.x - s * pc.y),
+            s,  c, qc.y - (s * pc.x + c * pc.y));
+        return M;
+    }
+
+    // Collinear or repeated vertices
+    bool degenerate(vector<Point2f> &p) {
+        double area = (p[1] - p[0]).cross(p[2] - p[0]);
+        return fabs(area) < 1E-6;
+    }
+
+    Mat affineFromTriangle(vector<Point2f> &p, vector<Point2f> &q) {
+        return getAffineTransform(&p[0], &q[0]);
+    }
+
+    /*
+      Marks as inliers the matches whose reprojection error under M is below
+      th pixels. src and dst hold the matched points as N x 1 CV_32FC2.
+
+      @return number of inliers
+    */
+    int scoreModel(Mat &M, Mat &src, Mat &dst, double th, Mat &mask) {
+        Mat proj, diff, dist;
+        transform(src, proj, M);
+        diff = proj - dst;
+        diff = diff.mul(diff);
+        reduce(diff.reshape(1, diff.rows), dist, 1, CV_REDUCE_SUM);
+        mask = dist < th * th;
+        return countNonZero(mask);
+    }
+
+    /*
+      Keeps only the point matches consistent with a single transform between
+      both images.
+
+      @param edge_matches hyperedge matches used to build hypotheses
+      @param matches point matches to verify
+      @param model_type kind of transform to fit
+      @param model output 2x3 transform, empty if no hypothesis could be made
+      @param th maximum reprojection error of an inlier, in pixels
+      @param consensus fraction of inliers after which the search stops
+      @return inlier matches, or matches unchanged if model is empty
+    */
+    vector<DMatch> geometric(
+        vector<pair<int, int> > &edge_matches, vector<DMatch> &matches,
+        vector<KeyPoint> &kpts1, vector<KeyPoint> &kpts2,
+        vector<vector<int> > &edges1, vector<vector<int> > &edges2,
+        Model model_type, Mat &model,
+        double th = 3.0, double consensus = 0.8
+    ) {
+        model = Mat();
+        if (matches.size() < 3) {
+            return matches;
+        }
+
+        Mat src(matches.size(), 1, CV_32FC2), dst(matches.size(), 1, CV_32FC2);
+        map<pair<int, int>, int> match_idx;
+        for (size_t i = 0; i < matches.size(); i++) {
+            src.at<Point2f>(i) = kpts1[matches[i].queryIdx].pt;
+            dst.at<Point2f>(i) = kpts2[matches[i].trainIdx].pt;
+            match_idx[make_pair(matches[i].queryIdx, matches[i].trainIdx)] = i;
+        }
+
+        int best_count = 0;
+        Mat best_mask, mask;
+        for (size_t i = 0; i < edge_matches.size(); i++) {
+            vector<int> &e1 = edges1[edge_matches[i].first];
+            vector<int> &e2 = edges2[edge_matches[i].second];
+
+            // Vertex correspondence given by the point matches
+            vector<Point2f> p(3), q(3);
+            vector<bool> used(3, false);
+            bool complete = true;
+            for (int j = 0; j < 3 && complete; j++) {
+                complete = false;
+                for (int k = 0; k < 3; k++) {
+                    if (!used[k] && match_idx.count(make_pair(e1[j], e2[k]))) {
+                        p[j] = kpts1[e1[j]].pt;
+                        q[j] = kpts2[e2[k]].pt;
+                        used[k] = true;
+                        complete = true;
+                        break;
+                    }
+                }
+            }
+            if (!complete || degenerate(p) || degenerate(q)) {
+                continue;
+            }
+
+            Mat M;
+            if (model_type == SIMILARITY) {
+                M = similarityFromPoints(p, q);
+            } else {
+                M = affineFromTriangle(p, q);
+            }
+            if (M.empty()) {
+                continue;
+            }
+
+            int count = scoreModel(M, src, dst, th, mask);
+            if (count > best_count) {
+                best_count = count;
+                model = M;
+                mask.copyTo(best_mask);
+                if (best_count >= consensus * matches.size()) {
+                    break;
+                }
+            }
+        }
+
+        if (model.empty()) {
+            return matches;
+        }
+
+        vector<DMatch> inliers;
+        for (size_t i = 0; i < matches.size(); i++) {
+            if (best_mask.at<uchar>(i)) {
+                inliers.push_back(matches[i]);
+            }
+        }
+        return inliers;
+    }
+}
@@ -0,0 +1,137 @@
+#include <bits/stdc++.h>
+#include "opencv2/core/core.hpp"
+#include "verify.hpp"
+#include "test.hpp"
+using namespace std;
+using namespace cv;
+
+const int ROWS = 6, COLS = 6;
+
+int idx(int r, int c) {
+    return r * COLS + c;
+}
+
+// Slightly irregular grid, so no triangle of it is degenerate
+vector<KeyPoint> gridKeypoints() {
+    vector<KeyPoint> kpts;
+    for (int r = 0; r < ROWS; r++) {
+        for (int c = 0; c < COLS; c++) {
+            Point2f p(50 + 40 * c + (r % 2) * 7, 40 + 35 * r + (c % 3) * 3);
+            kpts.push_back(KeyPoint(p, 1));
+        }
+    }
+    return kpts;
+}
+
+vector<vector<int> > gridEdges() {
+    vector<vector<int> > edges;
+    for (int r = 0; r + 1 < ROWS; r++) {
+        for (int c = 0; c + 1 < COLS; c++) {
+            int a[] = {idx(r, c), idx(r, c + 1), idx(r + 1, c)};
+            int b[] = {idx(r, c + 1), idx(r + 1, c + 1), idx(r + 1, c)};
+            edges.push_back(vector<int>(a, a + 3));
+            edges.push_back(vector<int>(b, b + 3));
+        }
+    }
+    return edges;
+}
+
+vector<KeyPoint> transformKeypoints(vector<KeyPoint> &kpts, Mat &M) {
+    vector<KeyPoint> out = kpts;
+    for (size_t i = 0; i < kpts.size(); i++) {
+        Point2f p = kpts[i].pt;
+        out[i].pt = Point2f(
+            M.at<double>(0, 0) * p.x + M.at<double>(0, 1) * p.y + M.at<double>(0, 2),
+            M.at<double>(1, 0) * p.x + M.at<double>(1, 1) * p.y + M.at<double>(1, 2)
+        );
+    }
+    return out;
+}
+
+bool isOutlier(int i) {
+    return i % 7 == 3;
+}
+
+// Every point matched to itself, except the outliers
+vector<DMatch> gridMatches(int n) {
+    vector<DMatch> matches;
+    for (int i = 0; i < n; i++) {
+        matches.push_back(DMatch(i, isOutlier(i) ? (i + 17) % n : i, 0));
+    }
+    return matches;
+}
+
+void testModel(verify::Model model_type, Mat truth, string name) {
+    vector<KeyPoint> kpts1 = gridKeypoints();
+    vector<KeyPoint> kpts2 = transformKeypoints(kpts1, truth);
+    vector<vector<int> > edges = gridEdges();
+    vector<pair<int, int> > edge_matches;
+    for (size_t i = 0; i < edges.size(); i++) {
+        edge_matches.push_back(make_pair(i, i));
+    }
+    vector<DMatch> matches = gridMatches(kpts1.size());
+
+    Mat model;
+    vector<DMatch> inliers = verify::geometric(
+        edge_matches, matches, kpts1, kpts2, edges, edges, model_type, model
+    );
+
+    check(!model.empty() && norm(model, truth, NORM_INF) < 1E-2,
+          name + ": model is recovered");
+    bool only_outliers_removed = true;
+    size_t n_inliers = 0;
+    for (size_t i = 0; i < matches.size(); i++) {
+        n_inliers += !isOutlier(i);
+    }
+    only_outliers_removed = inliers.size() == n_inliers;
+    for (size_t i = 0; i < inliers.size(); i++) {
+        only_outliers_removed = only_outliers_removed &&
+                                inliers[i].queryIdx == inliers[i].trainIdx;
+    }
+    check(only_outliers_removed, name + ": only the outliers are removed");
+}
+
+void testWithoutModel() {
+    vector<KeyPoint> kpts1 = gridKeypoints();
+    vector<vector<int> > edges = gridEdges();
+    vector<pair<int, int> > edge_matches;
+    for (size_t i = 0; i < edges.size(); i++) {
+        edge_matches.push_back(make_pair(i, i));
+    }
+
+    // All points of image 2 on a line, every hypothesis is degenerate
+    vector<KeyPoint> kpts2 = kpts1;
+    for (size_t i = 0; i < kpts2.size(); i++) {
+        kpts2[i].pt = Point2f(10 * i, 5 * i);
+    }
+    vector<DMatch> matches = gridMatches(kpts1.size());
+    Mat model;
+    vector<DMatch> out = verify::geometric(
+        edge_matches, matches, kpts1, kpts2, edges, edges, verify::AFFINE, model
+    );
+    check(model.empty() && out.size() == matches.size(),
+          "degenerate hypotheses: no model, matches unchanged");
+
+    vector<DMatch> few(matches.begin(), matches.begin() + 2);
+    out = verify::geometric(
+        edge_matches, few, kpts1, kpts1, edges, edges, verify::AFFINE, model
+    );
+    check(model.empty() && out.size() == few.size(),
+          "less than 3 matches: no model, matches unchanged");
+}
+
+int main(int argc, char* argv[]) {
+    double t = 20 * M_PI / 180, s = 1.2;
+    Mat similarity = (Mat_<double>(2, 3) <<
+        s * cos(t), -s * sin(t), 15,
+        s * sin(t),  s * cos(t), -7);
+    Mat affine = (Mat_<double>(2, 3) <<
+        1.1, 0.2, 5,
+        -0.1, 0.9, 12);
+
+    testModel(verify::SIMILARITY, similarity, "similarity");
+    testModel(verify::AFFINE, affine, "affine");
+    testWithoutModel();
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}